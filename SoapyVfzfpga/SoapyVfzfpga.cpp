@@ -1,62 +1,158 @@
 #include "SoapyVfzfpga.hpp"
 #include <SoapySDR/Logger.hpp>
 
-#include <SoapySDR/ConverterPrimatives.hpp>
+#include <SoapySDR/Formats.hpp>
+#include <SoapySDR/Time.hpp>
 
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
-// CS32 <> CF32
-static void genericCS32toCF32(const void *srcBuff, void *dstBuff, const size_t numElems, const double scaler)
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <sstream>
+
+
+// Converters are looked up here and not registered with the
+// ConverterRegistry, which would replace them for every device in the process
+
+// Native CS32 to RX output formats
+static SoapySDR::ConverterRegistry::ConverterFunction rxConverter(const std::string &format)
 {
-    const size_t elemDepth = 2;
-    
-    if (scaler == 1.0)
-    {
-        auto *src = (int32_t*)srcBuff;
-        auto *dst = (float*)dstBuff;
-        for (size_t i = 0; i < numElems*elemDepth; i++)
-        {
-            dst[i] = SoapySDR::S32toF32(src[i]);
-        }
-    }
-    else
+    if (format == SOAPY_SDR_CF64) return &genericConvert<cs32_t, cf64_t>;
+    if (format == SOAPY_SDR_CF32) return &genericConvert<cs32_t, cf32_t>;
+    if (format == SOAPY_SDR_CS32) return &genericConvert<cs32_t, cs32_t>;
+    if (format == SOAPY_SDR_CS16) return &genericConvert<cs32_t, cs16_t>;
+    if (format == SOAPY_SDR_CS8) return &genericConvert<cs32_t, cs8_t>;
+    if (format == SOAPY_SDR_CU8) return &genericConvert<cs32_t, cu8_t>;
+    return nullptr;
+}
+
+// TX input formats to native CS32
+static SoapySDR::ConverterRegistry::ConverterFunction txConverter(const std::string &format)
+{
+    if (format == SOAPY_SDR_CF32) return &genericConvert<cf32_t, cs32_t>;
+    if (format == SOAPY_SDR_CS32) return &genericConvert<cs32_t, cs32_t>;
+    if (format == SOAPY_SDR_CS16) return &genericConvert<cs16_t, cs32_t>;
+    return nullptr;
+}
+
+// Native CS32 to RX output formats with the fused DC removal stage
+static dc_converter_t dcConverter(const std::string &format)
+{
+    if (format == SOAPY_SDR_CF64) return &genericConvertDC<cs32_t, cf64_t>;
+    if (format == SOAPY_SDR_CF32) return &genericConvertDC<cs32_t, cf32_t>;
+    if (format == SOAPY_SDR_CS32) return &genericConvertDC<cs32_t, cs32_t>;
+    if (format == SOAPY_SDR_CS16) return &genericConvertDC<cs32_t, cs16_t>;
+    if (format == SOAPY_SDR_CS8) return &genericConvertDC<cs32_t, cs8_t>;
+    if (format == SOAPY_SDR_CU8) return &genericConvertDC<cs32_t, cu8_t>;
+    return nullptr;
+}
+
+// Board controls
+static const std::string kSysfsPath = "/sys/class/sdr/vfzsdr";
+
+static const char *sysfsAccess(const sysfs_attr_t &attr)
+{
+    if (!attr.readable) return " (write only)";
+    if (!attr.writable) return " (read only)";
+    return "";
+}
+
+// Burst detector block size in frames. Silence is skipped one block at a time.
+static const size_t kBurstBlock = 64;
+
+// Count frames with power above threshold. Branch free so that the compiler
+// can vectorize it, this is what runs on all the silence between bursts.
+static size_t burstCount(const int32_t *src, const size_t frames, const float threshold)
+{
+    size_t count = 0;
+    for (size_t i = 0; i < frames; i++)
     {
-        auto *src = (int32_t*)srcBuff;
-        auto *dst = (int32_t*)dstBuff;
-        for (size_t i = 0; i < numElems*elemDepth; i++)
-        {
-            dst[i] = SoapySDR::S32toF32(src[i]) * scaler;
-        }
+        const float re = src[2*i];
+        const float im = src[2*i + 1];
+        count += (re*re + im*im) > threshold;
     }
+    return count;
+}
+
+static bool burstAbove(const int32_t *frame, const float threshold)
+{
+    const float re = frame[0];
+    const float im = frame[1];
+    return (re*re + im*im) > threshold;
 }
 
-// CS32 <> CS16 scaler ignored
-static void genericCS32toCS16(const void *srcBuff, void *dstBuff, const size_t numElems, const double scaler)
+// First frame above threshold or frames if none
+static size_t burstFirst(const int32_t *src, const size_t frames, const float threshold)
 {
-    const size_t elemDepth = 2;
+    if (burstCount(src, frames, threshold) == 0) return frames;
     
-    auto *src = (int32_t*)srcBuff;
-    auto *dst = (int16_t*)dstBuff;
-    for (size_t i = 0; i < numElems*elemDepth; i++)
-    {
-        dst[i] = SoapySDR::S32toS16(src[i]);
-    }
+    size_t i = 0;
+    while (!burstAbove(&src[2*i], threshold)) i++;
+    return i;
+}
+
+// Last frame above threshold or frames if none
+static size_t burstLast(const int32_t *src, const size_t frames, const float threshold)
+{
+    if (burstCount(src, frames, threshold) == 0) return frames;
+    
+    size_t i = frames - 1;
+    while (!burstAbove(&src[2*i], threshold)) i--;
+    return i;
 }
 
 
 SoapyVfzfgpa::SoapyVfzfgpa() :
+d_pcm_handle(nullptr),
 d_agc_mode(false),
 d_period_size(4096),
 d_frequency(0),
-d_sample_rate(89286)
+d_sample_rate(89286),
+d_ticks(0),
+d_burst_mode(false),
+d_burst_threshold(0),
+d_burst_pre(0),
+d_burst_post(0),
+d_tx_pcm_handle(nullptr),
+d_tx_prefill(0),
+d_tx_linked(false),
+d_tx_status(0),
+d_tx_xrun_reported(false),
+d_tx_converter_func(nullptr),
+d_scan_mode(false),
+d_scan_index(0),
+d_scan_dwell(0),
+d_scan_settle(1024),
+d_scan_discard(0),
+d_scan_remaining(0),
+d_scan_frequency(0),
+d_scan_dirty(false),
+d_sysfs_dirty(false),
+d_dc_mode(false),
+d_dc_converter_func(nullptr),
+d_gain(0),
+d_gain_scaler(1.0)
 {
-    d_freq_f.open("/sys/class/sdr/vfzsdr/frequency");
-    // Sample buffer
+    d_scan_next.enabled = false;
+    d_scan_next.dwell = 0;
+    d_scan_next.settle = d_scan_settle;
+    
+    sysfsOpen();
+    // Sample buffers
     d_buff.resize(2 * d_period_size);
+    d_tx_buff.resize(2 * d_period_size);
 }
 
 SoapyVfzfgpa::~SoapyVfzfgpa()
 {
-    d_freq_f.close();
+    for (auto &attr : d_sysfs) {
+        close(attr.second.fd);
+    }
 }
 
 // Identification API
@@ -73,13 +169,13 @@ std::string SoapyVfzfgpa::getHardwareKey() const
 // Channels API
 size_t SoapyVfzfgpa::getNumChannels(const int dir) const
 {
-    return (dir == SOAPY_SDR_RX) ? 1 : 0;
+    return 1;
 }
 
 bool SoapyVfzfgpa::getFullDuplex(const int direction, const size_t channel) const
 {
     SoapySDR_log(SOAPY_SDR_INFO, "getFullDuplex");
-    return false;
+    return true;
 }
 
 // Stream API
@@ -89,6 +185,11 @@ std::vector<std::string> SoapyVfzfgpa::getStreamFormats(const int direction, con
     formats.push_back("CS16");
     formats.push_back("CS32");
     formats.push_back("CF32");
+    if (direction == SOAPY_SDR_RX) {
+        formats.push_back("CF64");
+        formats.push_back("CS8");
+        formats.push_back("CU8");
+    }
     return formats;
 }
 
@@ -106,7 +207,7 @@ SoapySDR::ArgInfoList SoapyVfzfgpa::getStreamArgsInfo(const int direction, const
     chanArg.key = "chan";
     chanArg.value = "stereo_iq";
     chanArg.name = "Channel Setup";
-    chanArg.description = "Input channel configuration.";
+    chanArg.description = "Channel configuration.";
     chanArg.type = SoapySDR::ArgInfo::STRING;
     
     std::vector<std::string> chanOpts;
@@ -120,19 +221,68 @@ SoapySDR::ArgInfoList SoapyVfzfgpa::getStreamArgsInfo(const int direction, const
     
     streamArgs.push_back(chanArg);
     
+    SoapySDR::ArgInfo pcmArg;
+    pcmArg.key = "pcm";
+    pcmArg.value = "vfzsdr";
+    pcmArg.name = "ALSA PCM";
+    pcmArg.description = "ALSA PCM device name, e.g. hw:Loopback for testing.";
+    pcmArg.type = SoapySDR::ArgInfo::STRING;
+    streamArgs.push_back(pcmArg);
+    
+    if (direction == SOAPY_SDR_TX)
+    {
+        SoapySDR::ArgInfo prefillArg;
+        prefillArg.key = "prefill";
+        prefillArg.value = std::to_string(2 * d_period_size);
+        prefillArg.name = "Prefill";
+        prefillArg.description = "Silence written before TX starts. Sets the RX to TX latency when both streams are active.";
+        prefillArg.units = "samples";
+        prefillArg.type = SoapySDR::ArgInfo::INT;
+        streamArgs.push_back(prefillArg);
+        
+        return streamArgs;
+    }
+    
+    SoapySDR::ArgInfo burstArg;
+    burstArg.key = "burst";
+    burstArg.value = "false";
+    burstArg.name = "Burst Capture";
+    burstArg.description = "Only deliver samples around bursts above the power threshold.";
+    burstArg.type = SoapySDR::ArgInfo::BOOL;
+    streamArgs.push_back(burstArg);
+    
+    SoapySDR::ArgInfo thresholdArg;
+    thresholdArg.key = "burst_threshold";
+    thresholdArg.value = "-40";
+    thresholdArg.name = "Burst Threshold";
+    thresholdArg.description = "Burst trigger power threshold.";
+    thresholdArg.units = "dBFS";
+    thresholdArg.type = SoapySDR::ArgInfo::FLOAT;
+    streamArgs.push_back(thresholdArg);
+    
+    SoapySDR::ArgInfo preArg;
+    preArg.key = "burst_pre";
+    preArg.value = "1024";
+    preArg.name = "Pre-trigger";
+    preArg.description = "Samples delivered before the trigger.";
+    preArg.units = "samples";
+    preArg.type = SoapySDR::ArgInfo::INT;
+    streamArgs.push_back(preArg);
+    
+    SoapySDR::ArgInfo postArg;
+    postArg.key = "burst_post";
+    postArg.value = "1024";
+    postArg.name = "Post-trigger";
+    postArg.description = "Samples delivered after the signal drops below threshold.";
+    postArg.units = "samples";
+    postArg.type = SoapySDR::ArgInfo::INT;
+    streamArgs.push_back(postArg);
+    
     return streamArgs;
 }
 
 SoapySDR::Stream *SoapyVfzfgpa::setupStream(const int direction, const std::string &format, const std::vector<size_t> &channels, const SoapySDR::Kwargs &args)
 {
-    // Register format converters once
-    static SoapySDR::ConverterRegistry registerGenericCS32toCF32(SOAPY_SDR_CS32, SOAPY_SDR_CF32, SoapySDR::ConverterRegistry::GENERIC, &genericCS32toCF32);
-    static SoapySDR::ConverterRegistry registerGenericCS32toCS16(SOAPY_SDR_CS32, SOAPY_SDR_CS16, SoapySDR::ConverterRegistry::GENERIC, &genericCS32toCS16);
-    
-    if (direction != SOAPY_SDR_RX) {
-        throw std::runtime_error("setupStream only RX supported");
-    }
-    
     //check the channel configuration
     if (channels.size() > 1 or (channels.size() > 0 and channels.at(0) != 0))
     {
@@ -141,24 +291,92 @@ SoapySDR::Stream *SoapyVfzfgpa::setupStream(const int direction, const std::stri
     
     SoapySDR_logf(SOAPY_SDR_INFO, "Wants format %s", format.c_str());
     
+    const std::string pcm = args.count("pcm") ? args.at("pcm") : "vfzsdr";
+    
+    if (direction == SOAPY_SDR_TX)
+    {
+        if (d_tx_pcm_handle != nullptr) {
+            throw std::runtime_error("setupStream TX stream already open");
+        }
+        
+        // Format converter function
+        d_tx_converter_func = txConverter(format);
+        if (d_tx_converter_func == nullptr) {
+            throw std::runtime_error("setupStream unsupported TX format " + format);
+        }
+        
+        // The ALSA ring buffer is 4 periods, leave room for one
+        d_tx_prefill = args.count("prefill") ? std::stoul(args.at("prefill")) : 2 * d_period_size;
+        d_tx_prefill = MIN(d_tx_prefill, 3 * size_t(d_period_size));
+        
+        d_tx_pcm_handle = alsa_pcm_handle(pcm.c_str(), d_period_size, SND_PCM_STREAM_PLAYBACK);
+        assert(d_tx_pcm_handle != nullptr);
+        
+        return (SoapySDR::Stream *) &d_tx_pcm_handle;
+    }
+    
     // Format converter function
-    d_converter_func = SoapySDR::ConverterRegistry::getFunction("CS32", format);
+    d_converter_func = rxConverter(format);
     assert(d_converter_func != nullptr);
+    d_dc_converter_func = dcConverter(format);
+    d_dc_state.i = 0;
+    d_dc_state.q = 0;
+    
+    // Burst capture
+    d_burst_mode = args.count("burst") and args.at("burst") == "true";
+    if (d_burst_mode)
+    {
+        const double threshold = args.count("burst_threshold") ? std::stod(args.at("burst_threshold")) : -40.0;
+        d_burst_pre = args.count("burst_pre") ? std::stoul(args.at("burst_pre")) : 1024;
+        d_burst_post = args.count("burst_post") ? std::stoul(args.at("burst_post")) : 1024;
+        
+        // Power relative to full scale of the native S32 samples
+        d_burst_threshold = float(std::ldexp(std::pow(10.0, threshold / 10.0), 62));
+        d_burst_hist.resize(2 * d_burst_pre);
+        
+        SoapySDR_logf(SOAPY_SDR_INFO, "Burst capture threshold %f dBFS, pre %zu, post %zu",
+                      threshold, d_burst_pre, d_burst_post);
+    }
+    burstReset();
     
-    d_pcm_handle = alsa_pcm_handle("vfzsdr", d_period_size, SND_PCM_STREAM_CAPTURE);
+    d_pcm_handle = alsa_pcm_handle(pcm.c_str(), d_period_size, SND_PCM_STREAM_CAPTURE);
     assert(d_pcm_handle != nullptr);
     
     return (SoapySDR::Stream *) this;
 }
 
+bool SoapyVfzfgpa::isTxStream(SoapySDR::Stream *stream) const
+{
+    return stream == (SoapySDR::Stream *) &d_tx_pcm_handle;
+}
+
+// Stop starting and stopping TX together with RX
+void SoapyVfzfgpa::txUnlink(void)
+{
+    if (d_tx_linked) {
+        snd_pcm_unlink(d_tx_pcm_handle);
+        d_tx_linked = false;
+    }
+}
+
 void SoapyVfzfgpa::closeStream(SoapySDR::Stream *stream)
 {
     SoapySDR_log(SOAPY_SDR_INFO, "close stream");
+    
+    if (isTxStream(stream)) {
+        if (d_tx_pcm_handle != nullptr) {
+            txUnlink();
+            snd_pcm_close(d_tx_pcm_handle);
+            d_tx_pcm_handle = nullptr;
+        }
+        return;
+    }
+    
     if (d_pcm_handle != nullptr) {
+        if (d_tx_pcm_handle != nullptr) txUnlink();
         snd_pcm_close(d_pcm_handle);
+        d_pcm_handle = nullptr;
     }
-    
-    
 }
 
 size_t SoapyVfzfgpa::getStreamMTU(SoapySDR::Stream *stream) const
@@ -173,10 +391,52 @@ int SoapyVfzfgpa::activateStream(SoapySDR::Stream *stream,
                                  const size_t numElems)
 {
     SoapySDR_log(SOAPY_SDR_INFO, "activate stream");
+    
+    if (isTxStream(stream))
+    {
+        {
+            std::lock_guard<std::mutex> lock(d_tx_status_mutex);
+            d_tx_status = 0;
+            d_tx_xrun_reported = false;
+        }
+        
+        // Link to a prepared RX stream so both start on the same frame. The
+        // prefill is then the fixed RX to TX latency. This needs TX to be
+        // activated before RX.
+        if (d_pcm_handle != nullptr)
+        {
+            if (snd_pcm_state(d_pcm_handle) == SND_PCM_STATE_RUNNING) {
+                SoapySDR_log(SOAPY_SDR_WARNING, "activateStream RX already running, RX to TX latency is not fixed. Activate TX first.");
+            } else if (snd_pcm_link(d_pcm_handle, d_tx_pcm_handle) == 0) {
+                d_tx_linked = true;
+            } else {
+                SoapySDR_log(SOAPY_SDR_WARNING, "activateStream can not link TX to RX, RX to TX latency is not fixed");
+            }
+        }
+        
+        std::fill(d_tx_buff.begin(), d_tx_buff.end(), 0);
+        for (size_t n = 0; n < d_tx_prefill; n += d_period_size) {
+            snd_pcm_writei(d_tx_pcm_handle, &d_tx_buff[0], MIN(d_period_size, d_tx_prefill - n));
+        }
+        
+        // Otherwise start now, RX activateStream starts a linked TX
+        if (!d_tx_linked) {
+            snd_pcm_start(d_tx_pcm_handle);
+        }
+        
+        return 0;
+    }
 
+    d_ticks = 0;
+    burstReset();
+    
     // snd_pcm_prepare(d_pcm_handle);
     snd_pcm_start(d_pcm_handle);
     
+    // Linked PCMs also stop together. Both are running now with the latency
+    // fixed, unlink so that an xrun on one side does not stop the other.
+    if (d_tx_pcm_handle != nullptr) txUnlink();
+    
     return 0;
 }
 
@@ -186,27 +446,41 @@ int SoapyVfzfgpa::deactivateStream(SoapySDR::Stream *stream, const int flags, co
  
     if (flags != 0) return SOAPY_SDR_NOT_SUPPORTED;
     
-    snd_pcm_drop(d_pcm_handle);
-    snd_pcm_prepare(d_pcm_handle);
+    // Linked streams stop together, only stop the one asked for
+    if (d_tx_pcm_handle != nullptr) txUnlink();
+    
+    snd_pcm_t *pcm_handle = isTxStream(stream) ? d_tx_pcm_handle : d_pcm_handle;
+    snd_pcm_drop(pcm_handle);
+    snd_pcm_prepare(pcm_handle);
     
     return 0;
 }
 
-int SoapyVfzfgpa::readStream(SoapySDR::Stream *stream,
-                             void * const *buffs,
-                             const size_t numElems,
-                             int &flags,
-                             long long &timeNs,
-                             const long timeoutUs)
+// Time left of a readStream timeout spread over several readPeriod calls
+static long timeLeftUs(const std::chrono::steady_clock::time_point &deadline)
+{
+    return (long) std::chrono::duration_cast<std::chrono::microseconds>(deadline - std::chrono::steady_clock::now()).count();
+}
+
+int SoapyVfzfgpa::readPeriod(const size_t numElems, const long timeoutUs)
 {
     // This function has to be well defined at all times
     if (d_pcm_handle == nullptr) {
         return 0;
     }
     
-    // Are we running?
-    if (snd_pcm_state(d_pcm_handle) != SND_PCM_STATE_RUNNING) {
-        return 0;
+    // Are we running? An overrun between calls leaves the PCM stopped.
+    switch (snd_pcm_state(d_pcm_handle)) {
+        case SND_PCM_STATE_RUNNING:
+            break;
+        case SND_PCM_STATE_XRUN:
+            return readRecover(-EPIPE);
+        case SND_PCM_STATE_SUSPENDED:
+            return readRecover(-ESTRPIPE);
+        case SND_PCM_STATE_DISCONNECTED:
+            return SOAPY_SDR_STREAM_ERROR;
+        default:
+            return 0;
     }
     
     // Timeout if not ready
@@ -214,39 +488,594 @@ int SoapyVfzfgpa::readStream(SoapySDR::Stream *stream,
         return SOAPY_SDR_TIMEOUT;
     }
     
+    // Batched settings are applied between periods
+    if (d_sysfs_dirty) {
+        sysfsApplyPending();
+    }
+    
     // Read from ALSA
     snd_pcm_sframes_t frames = 0;
     int err = 0;
-    // no program is complete without a goto
-again:
+    
     // read numElems or d_period_size
     frames = snd_pcm_readi(d_pcm_handle, &d_buff[0], MIN(d_period_size, numElems));
     // try to handle xruns
     if(frames < 0) {
         err = (int) frames;
-        if(snd_pcm_recover(d_pcm_handle, err, 0) == 0) {
-            SoapySDR_logf(SOAPY_SDR_ERROR, "readStream recoverd from %s", snd_strerror(err));
+        return readRecover(err);
+    }
+    
+    d_ticks += frames;
+    
+    return (int)frames;
+}
+
+// Restart capture after an xrun or suspend. The frames lost are those left
+// unread in the ring and those not captured while stopped, both are added to
+// the ticks so that timestamps stay on the sample clock. Tells the caller once.
+int SoapyVfzfgpa::readRecover(const int err)
+{
+    snd_pcm_status_t *status;
+    snd_pcm_status_alloca(&status);
+    
+    snd_pcm_uframes_t lost = 0;
+    snd_htimestamp_t stopped = {0, 0};
+    if (snd_pcm_status(d_pcm_handle, status) == 0) {
+        lost = snd_pcm_status_get_avail(status);
+        snd_pcm_status_get_trigger_htstamp(status, &stopped);
+    }
+    
+    if (snd_pcm_recover(d_pcm_handle, err, 1) != 0 or snd_pcm_start(d_pcm_handle) != 0) {
+        SoapySDR_logf(SOAPY_SDR_ERROR, "readStream error: %s", snd_strerror(err));
+        return SOAPY_SDR_STREAM_ERROR;
+    }
+    
+    // Trigger timestamps are taken when the PCM stops and when it starts
+    snd_htimestamp_t started = {0, 0};
+    if (snd_pcm_status(d_pcm_handle, status) == 0 and stopped.tv_sec != 0) {
+        snd_pcm_status_get_trigger_htstamp(status, &started);
+        const double gap = (started.tv_sec - stopped.tv_sec) + 1e-9 * (started.tv_nsec - stopped.tv_nsec);
+        lost += (snd_pcm_uframes_t) std::llround(MAX(gap, 0.0) * d_sample_rate);
+    }
+    d_ticks += lost;
+    
+    SoapySDR_logf(SOAPY_SDR_ERROR, "readStream recovered from %s, %lu samples lost", snd_strerror(err), (unsigned long) lost);
+    return SOAPY_SDR_OVERFLOW;
+}
+
+int SoapyVfzfgpa::readStream(SoapySDR::Stream *stream,
+                             void * const *buffs,
+                             const size_t numElems,
+                             int &flags,
+                             long long &timeNs,
+                             const long timeoutUs)
+{
+    // Scan settings are applied between periods
+    if (d_scan_dirty) {
+        scanApplyPending();
+    }
+    
+    if (d_scan_mode) {
+        return readScan(buffs, numElems, flags, timeNs, timeoutUs);
+    }
+    
+    if (d_burst_mode) {
+        return readBurst(buffs, numElems, flags, timeNs, timeoutUs);
+    }
+    
+    const int frames = readPeriod(numElems, timeoutUs);
+    if (frames <= 0) {
+        return frames;
+    }
+    
+    convertRx(&d_buff[0], buffs[0], frames);
+    
+    return frames;
+}
+
+// Convert native samples to the stream format. Format is setup in
+// setupStream, DC removal and digital gain are fused into the conversion.
+void SoapyVfzfgpa::convertRx(const int32_t *src, void *dst, const size_t frames)
+{
+    if (d_dc_mode and d_dc_converter_func != nullptr) {
+        d_dc_converter_func(src, dst, frames, d_gain_scaler, d_dc_state);
+    } else {
+        d_converter_func(src, dst, frames, d_gain_scaler);
+    }
+}
+
+void SoapyVfzfgpa::burstReset(void)
+{
+    d_burst_active = false;
+    d_burst_quiet = 0;
+    d_burst_hist_pos = 0;
+    d_burst_hist_len = 0;
+    d_burst_data.clear();
+    d_burst_head = 0;
+    d_bursts.clear();
+}
+
+// Samples were lost, end the active burst where the data stops and drop the
+// pre-trigger history, neither is contiguous with what comes next
+void SoapyVfzfgpa::burstBreak(void)
+{
+    if (d_burst_active) {
+        d_bursts.back().complete = true;
+        d_burst_active = false;
+    }
+    d_burst_hist_len = 0;
+}
+
+// Keep the last d_burst_pre frames seen outside of a burst
+void SoapyVfzfgpa::burstHistoryPush(const int32_t *src, size_t frames)
+{
+    if (d_burst_pre == 0) return;
+    
+    if (frames > d_burst_pre) {
+        src += 2 * (frames - d_burst_pre);
+        frames = d_burst_pre;
+    }
+    
+    for (size_t i = 0; i < frames; i++)
+    {
+        d_burst_hist[2*d_burst_hist_pos] = src[2*i];
+        d_burst_hist[2*d_burst_hist_pos + 1] = src[2*i + 1];
+        d_burst_hist_pos = (d_burst_hist_pos + 1) % d_burst_pre;
+    }
+    d_burst_hist_len = MIN(d_burst_hist_len + frames, d_burst_pre);
+}
+
+// Append frames to the burst at the back of the queue
+void SoapyVfzfgpa::burstQueue(const int32_t *src, const size_t frames)
+{
+    d_burst_data.insert(d_burst_data.end(), src, src + 2 * frames);
+    d_bursts.back().frames += frames;
+}
+
+// Run the detector over the last period read into d_buff
+void SoapyVfzfgpa::burstDetect(const size_t frames)
+{
+    const int32_t *src = &d_buff[0];
+    const long long ticks = d_ticks - frames;
+    
+    size_t i = 0;
+    while (i < frames)
+    {
+        const size_t n = MIN(kBurstBlock, frames - i);
+        
+        if (!d_burst_active)
+        {
+            const size_t first = burstFirst(&src[2*i], n, d_burst_threshold);
+            burstHistoryPush(&src[2*i], first);
+            if (first == n) {
+                i += n;
+                continue;
+            }
+            i += first;
+            
+            // Trigger, start the burst with the pre-trigger history
+            burst_t burst;
+            burst.ticks = ticks + i - d_burst_hist_len;
+            burst.frames = 0;
+            burst.consumed = 0;
+            burst.complete = false;
+            d_bursts.push_back(burst);
+            
+            const size_t oldest = (d_burst_hist_pos + d_burst_pre - d_burst_hist_len) % MAX(d_burst_pre, 1);
+            for (size_t j = 0; j < d_burst_hist_len; j++)
+            {
+                burstQueue(&d_burst_hist[2 * ((oldest + j) % d_burst_pre)], 1);
+            }
+            d_burst_hist_len = 0;
+            
+            d_burst_active = true;
+            d_burst_quiet = 0;
+            continue;
+        }
+        
+        const size_t last = burstLast(&src[2*i], n, d_burst_threshold);
+        if (last == n) {
+            d_burst_quiet += n;
+        } else {
+            d_burst_quiet = n - 1 - last;
+        }
+        
+        if (d_burst_quiet >= d_burst_post)
+        {
+            // Post-trigger history captured, end the burst
+            const size_t end = n - (d_burst_quiet - d_burst_post);
+            burstQueue(&src[2*i], end);
+            d_bursts.back().complete = true;
+            d_burst_active = false;
+            i += end;
+            continue;
+        }
+        
+        burstQueue(&src[2*i], n);
+        i += n;
+    }
+}
+
+int SoapyVfzfgpa::readBurst(void * const *buffs,
+                            const size_t numElems,
+                            int &flags,
+                            long long &timeNs,
+                            const long timeoutUs)
+{
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::microseconds(timeoutUs);
+    
+    flags = 0;
+    
+    // Scan periods until there is something to deliver. A complete burst
+    // with nothing left still has its END_BURST to deliver.
+    while (d_bursts.empty() or (d_bursts.front().consumed == d_bursts.front().frames and
+                                !d_bursts.front().complete))
+    {
+        const long remainingUs = timeLeftUs(deadline);
+        if (remainingUs <= 0) {
+            return SOAPY_SDR_TIMEOUT;
+        }
+        
+        const int frames = readPeriod(d_period_size, remainingUs);
+        if (frames == SOAPY_SDR_OVERFLOW) {
+            burstBreak();
+        }
+        if (frames <= 0) {
+            return frames;
+        }
+        
+        burstDetect(frames);
+    }
+    
+    // Deliver from the oldest burst, never across a burst boundary. This is
+    // a zero length read when a break ended the burst after its last frame.
+    burst_t &burst = d_bursts.front();
+    const size_t n = MIN(numElems, burst.frames - burst.consumed);
+    
+    convertRx(&d_burst_data[2*d_burst_head], buffs[0], n);
+    
+    flags |= SOAPY_SDR_HAS_TIME;
+    timeNs = SoapySDR::ticksToTimeNs(burst.ticks + burst.consumed, d_sample_rate);
+    
+    burst.consumed += n;
+    d_burst_head += n;
+    
+    if (burst.complete and burst.consumed == burst.frames) {
+        flags |= SOAPY_SDR_END_BURST;
+        d_bursts.pop_front();
+    }
+    
+    // Everything queued has been delivered
+    if (2 * d_burst_head == d_burst_data.size()) {
+        d_burst_data.clear();
+        d_burst_head = 0;
+    }
+    
+    return (int)n;
+}
+
+
+// RX is activated, settings must then wait for readStream
+bool SoapyVfzfgpa::rxStreaming(void)
+{
+    if (d_pcm_handle == nullptr) return false;
+    
+    const snd_pcm_state_t state = snd_pcm_state(d_pcm_handle);
+    return state != SND_PCM_STATE_OPEN and state != SND_PCM_STATE_SETUP and state != SND_PCM_STATE_PREPARED;
+}
+
+// Take over the settings staged by writeSetting. A new list or dwell
+// restarts the scan from the first frequency.
+void SoapyVfzfgpa::scanApplyPending(void)
+{
+    std::lock_guard<std::mutex> lock(d_scan_mutex);
+    
+    const bool restart = (d_scan_next.enabled and !d_scan_mode) or
+                         d_scan_next.freqs != d_scan_freqs or
+                         d_scan_next.dwell != d_scan_dwell;
+    
+    d_scan_mode = d_scan_next.enabled;
+    d_scan_freqs = d_scan_next.freqs;
+    d_scan_dwell = d_scan_next.dwell;
+    d_scan_settle = d_scan_next.settle;
+    d_scan_dirty = false;
+    
+    if (d_scan_mode and restart) {
+        scanTune(0);
+    }
+}
+
+// Longest scan list accepted
+static const size_t kScanMaxFrequencies = 4096;
+
+// Throw unless all of freqs are in the tuning range
+static void scanCheck(const std::vector<double> &freqs, const SoapySDR::Range &range)
+{
+    if (freqs.size() > kScanMaxFrequencies) {
+        throw std::runtime_error("writeSetting scan list longer than " + std::to_string(kScanMaxFrequencies));
+    }
+    for (double freq : freqs)
+    {
+        if (freq < range.minimum() or freq > range.maximum()) {
+            throw std::runtime_error("writeSetting scan frequency " + std::to_string(freq) + " out of range");
+        }
+    }
+}
+
+// Retune to the given scan list entry and start a new dwell. Entries the
+// board does not take are skipped, if it takes none there is no dwell.
+int SoapyVfzfgpa::scanTune(const size_t index)
+{
+    d_scan_remaining = 0;
+    
+    size_t n = 0;
+    for (; n < d_scan_freqs.size(); n++)
+    {
+        d_scan_index = (index + n) % d_scan_freqs.size();
+        if (writeFrequency(d_scan_freqs[d_scan_index]) == 0) break;
+        SoapySDR_logf(SOAPY_SDR_WARNING, "scan skips %f Hz, retune failed", d_scan_freqs[d_scan_index]);
+    }
+    if (n == d_scan_freqs.size()) {
+        d_scan_index = index;
+        SoapySDR_log(SOAPY_SDR_ERROR, "scan retune failed for every frequency");
+        return SOAPY_SDR_STREAM_ERROR;
+    }
+    
+    // Everything captured so far is from before the retune. The delay covers
+    // the ring and the hardware, but the hardware pointer may only move once
+    // per period so add one more.
+    snd_pcm_sframes_t delay = 0;
+    if (d_pcm_handle != nullptr and snd_pcm_delay(d_pcm_handle, &delay) < 0) {
+        delay = snd_pcm_avail(d_pcm_handle);
+    }
+    
+    d_scan_discard = MAX(delay, 0) + d_period_size + d_scan_settle;
+    d_scan_remaining = d_scan_dwell;
+    
+    return 0;
+}
+
+int SoapyVfzfgpa::readScan(void * const *buffs,
+                           const size_t numElems,
+                           int &flags,
+                           long long &timeNs,
+                           const long timeoutUs)
+{
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::microseconds(timeoutUs);
+    
+    flags = 0;
+    
+    // The last retune failed, try again rather than tag samples wrongly
+    if (d_scan_remaining == 0) {
+        const int ret = scanTune(d_scan_index);
+        if (ret != 0) {
+            return ret;
+        }
+    }
+    
+    // Drop samples from before the retune and while settling
+    while (d_scan_discard > 0)
+    {
+        const long remainingUs = timeLeftUs(deadline);
+        if (remainingUs <= 0) {
+            return SOAPY_SDR_TIMEOUT;
+        }
+        
+        const int frames = readPeriod(d_scan_discard, remainingUs);
+        if (frames == SOAPY_SDR_OVERFLOW) {
+            scanTune(d_scan_index);
+        }
+        if (frames <= 0) {
+            return frames;
+        }
+        d_scan_discard -= frames;
+    }
+    
+    const long remainingUs = timeLeftUs(deadline);
+    const int frames = readPeriod(MIN(numElems, d_scan_remaining), MAX(remainingUs, 0));
+    
+    // Samples were lost, start this dwell over
+    if (frames == SOAPY_SDR_OVERFLOW) {
+        scanTune(d_scan_index);
+    }
+    if (frames <= 0) {
+        return frames;
+    }
+    
+    convertRx(&d_buff[0], buffs[0], frames);
+    
+    flags |= SOAPY_SDR_HAS_TIME;
+    timeNs = SoapySDR::ticksToTimeNs(d_ticks - frames, d_sample_rate);
+    d_scan_frequency = d_frequency;
+    
+    // Last block of this dwell, move on
+    d_scan_remaining -= frames;
+    if (d_scan_remaining == 0) {
+        flags |= SOAPY_SDR_END_BURST;
+        scanTune((d_scan_index + 1) % d_scan_freqs.size());
+    }
+    
+    return frames;
+}
+
+int SoapyVfzfgpa::writePeriod(const size_t numElems, const long timeoutUs)
+{
+    // This function has to be well defined at all times
+    if (d_tx_pcm_handle == nullptr) {
+        return 0;
+    }
+    
+    // Timeout if there is no room
+    if(snd_pcm_wait(d_tx_pcm_handle, int(timeoutUs / 1000)) == 0) {
+        return SOAPY_SDR_TIMEOUT;
+    }
+    
+    snd_pcm_sframes_t frames = 0;
+    int err = 0;
+    bool restart = false;
+again:
+    frames = snd_pcm_writei(d_tx_pcm_handle, &d_tx_buff[0], numElems);
+    // try to handle xruns
+    if(frames < 0) {
+        err = (int) frames;
+        // Recovering a linked PCM prepares RX too, unlink first. A linked RX
+        // stopped with TX and readStream restarts it with an overflow.
+        txUnlink();
+        if(snd_pcm_recover(d_tx_pcm_handle, err, 1) == 0) {
+            SoapySDR_logf(SOAPY_SDR_ERROR, "writeStream recovered from %s", snd_strerror(err));
+            if (err == -EPIPE) {
+                std::lock_guard<std::mutex> lock(d_tx_status_mutex);
+                if (!d_tx_xrun_reported) {
+                    d_tx_status = SOAPY_SDR_UNDERFLOW;
+                    d_tx_status_cond.notify_all();
+                }
+                d_tx_xrun_reported = false;
+            }
+            restart = true;
             goto again;
         } else {
-            SoapySDR_logf(SOAPY_SDR_ERROR, "readStream error: %s", snd_strerror(err));
+            SoapySDR_logf(SOAPY_SDR_ERROR, "writeStream error: %s", snd_strerror(err));
             return SOAPY_SDR_STREAM_ERROR;
         }
     }
     
-    // Convert. Format is setup in setupStream. 1.0 means to do nothing.
-    d_converter_func(&d_buff[0], buffs[0], frames, 1.0);
+    // Timing relative to RX is lost, restart TX on its own
+    if (restart) {
+        snd_pcm_start(d_tx_pcm_handle);
+    }
     
     return (int)frames;
 }
 
+int SoapyVfzfgpa::writeStream(SoapySDR::Stream *stream,
+                              const void * const *buffs,
+                              const size_t numElems,
+                              int &flags,
+                              const long long timeNs,
+                              const long timeoutUs)
+{
+    if (!isTxStream(stream)) return SOAPY_SDR_NOT_SUPPORTED;
+    if (d_tx_pcm_handle == nullptr) return SOAPY_SDR_STREAM_ERROR;
+    
+    const size_t frames = MIN(d_period_size, numElems);
+    
+    // Convert to native format. Format is setup in setupStream.
+    d_tx_converter_func(buffs[0], &d_tx_buff[0], frames, 1.0);
+    
+    return writePeriod(frames, timeoutUs);
+}
+
+// Queue a status event for readStreamStatus
+void SoapyVfzfgpa::txReport(const int status)
+{
+    std::lock_guard<std::mutex> lock(d_tx_status_mutex);
+    d_tx_status = status;
+    d_tx_status_cond.notify_all();
+}
+
+int SoapyVfzfgpa::readStreamStatus(SoapySDR::Stream *stream,
+                                   size_t &chanMask,
+                                   int &flags,
+                                   long long &timeNs,
+                                   const long timeoutUs)
+{
+    if (!isTxStream(stream)) return SOAPY_SDR_NOT_SUPPORTED;
+    if (d_tx_pcm_handle == nullptr) return SOAPY_SDR_STREAM_ERROR;
+    
+    // An xrun can only start on a period boundary, look at the PCM that often
+    const auto period = std::chrono::microseconds((long long)(1e6 * d_period_size / d_sample_rate));
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::microseconds(timeoutUs);
+    
+    std::unique_lock<std::mutex> lock(d_tx_status_mutex);
+    for (;;)
+    {
+        // When the application stops writing only the PCM state tells
+        if (d_tx_status == 0 and !d_tx_xrun_reported and
+            snd_pcm_state(d_tx_pcm_handle) == SND_PCM_STATE_XRUN) {
+            d_tx_status = SOAPY_SDR_UNDERFLOW;
+            d_tx_xrun_reported = true;
+        }
+        
+        if (d_tx_status != 0) {
+            const int status = d_tx_status;
+            d_tx_status = 0;
+            chanMask = 1;
+            flags = 0;
+            return status;
+        }
+        
+        const auto now = std::chrono::steady_clock::now();
+        if (now >= deadline) {
+            return SOAPY_SDR_TIMEOUT;
+        }
+        
+        const auto wait = std::chrono::duration_cast<std::chrono::microseconds>(deadline - now);
+        d_tx_status_cond.wait_for(lock, MIN(wait, period));
+    }
+}
+
+// The TX bounce buffer is the only direct access buffer. ALSA is opened for
+// interleaved read/write access so there is no mmap area to hand out.
+size_t SoapyVfzfgpa::getNumDirectAccessBuffers(SoapySDR::Stream *stream)
+{
+    return isTxStream(stream) ? 1 : 0;
+}
+
+int SoapyVfzfgpa::getDirectAccessBufferAddrs(SoapySDR::Stream *stream, const size_t handle, void **buffs)
+{
+    if (!isTxStream(stream) or handle != 0) return SOAPY_SDR_NOT_SUPPORTED;
+    
+    buffs[0] = &d_tx_buff[0];
+    return 0;
+}
+
+int SoapyVfzfgpa::acquireWriteBuffer(SoapySDR::Stream *stream,
+                                     size_t &handle,
+                                     void **buffs,
+                                     const long timeoutUs)
+{
+    if (!isTxStream(stream)) return SOAPY_SDR_NOT_SUPPORTED;
+    if (d_tx_pcm_handle == nullptr) return SOAPY_SDR_STREAM_ERROR;
+    
+    // Timeout if there is no room
+    if(snd_pcm_wait(d_tx_pcm_handle, int(timeoutUs / 1000)) == 0) {
+        return SOAPY_SDR_TIMEOUT;
+    }
+    
+    handle = 0;
+    buffs[0] = &d_tx_buff[0];
+    return d_period_size;
+}
+
+void SoapyVfzfgpa::releaseWriteBuffer(SoapySDR::Stream *stream,
+                                      const size_t handle,
+                                      const size_t numElems,
+                                      int &flags,
+                                      const long long timeNs)
+{
+    if (!isTxStream(stream) or d_tx_pcm_handle == nullptr) return;
+    
+    // Samples are already in native format. acquireWriteBuffer waited for
+    // room so this normally does not block.
+    const size_t frames = MIN(d_period_size, numElems);
+    const int ret = writePeriod(frames, 100000);
+    
+    // There is no return value, samples not written leave a gap in the output
+    if (ret == SOAPY_SDR_TIMEOUT or (ret >= 0 and size_t(ret) < frames)) {
+        SoapySDR_log(SOAPY_SDR_ERROR, "releaseWriteBuffer dropped samples");
+        txReport(SOAPY_SDR_UNDERFLOW);
+    } else if (ret < 0) {
+        txReport(ret);
+    }
+}
+
 
 std::vector<std::string> SoapyVfzfgpa::listAntennas(const int direction, const size_t channel) const
 {
     SoapySDR_log(SOAPY_SDR_INFO, "listAntennas");
     
     std::vector<std::string> antennas;
-    antennas.push_back("RX");
-    // antennas.push_back("TX");
+    antennas.push_back(direction == SOAPY_SDR_RX ? "RX" : "TX");
     return antennas;
 }
 
@@ -259,13 +1088,26 @@ void SoapyVfzfgpa::setAntenna(const int direction, const size_t channel, const s
 std::string SoapyVfzfgpa::getAntenna(const int direction, const size_t channel) const
 {
     SoapySDR_log(SOAPY_SDR_INFO, "getAntenna");
-    return "RX";
-    // return "TX";
+    return direction == SOAPY_SDR_RX ? "RX" : "TX";
 }
 
 bool SoapyVfzfgpa::hasDCOffsetMode(const int direction, const size_t channel) const
 {
-    return false;
+    return direction == SOAPY_SDR_RX;
+}
+
+void SoapyVfzfgpa::setDCOffsetMode(const int direction, const size_t channel, const bool automatic)
+{
+    SoapySDR_logf(SOAPY_SDR_DEBUG, "Setting DC removal: %s", automatic ? "On" : "Off");
+    
+    if (direction == SOAPY_SDR_RX) {
+        d_dc_mode = automatic;
+    }
+}
+
+bool SoapyVfzfgpa::getDCOffsetMode(const int direction, const size_t channel) const
+{
+    return direction == SOAPY_SDR_RX and d_dc_mode;
 }
 
 std::vector<std::string> SoapyVfzfgpa::listGains(const int direction, const size_t channel) const
@@ -274,6 +1116,11 @@ std::vector<std::string> SoapyVfzfgpa::listGains(const int direction, const size
     //the functions below have a "name" parameter
     std::vector<std::string> results;
     // results.push_back("AUDIO");
+    
+    // Applied in the format converter
+    if (direction == SOAPY_SDR_RX) {
+        results.push_back("DIGITAL");
+    }
     return results;
 }
 
@@ -307,17 +1154,31 @@ void SoapyVfzfgpa::setGain(const int direction, const size_t channel, const doub
 void SoapyVfzfgpa::setGain(const int direction, const size_t channel, const std::string &name, const double value)
 {
     SoapySDR_logf(SOAPY_SDR_DEBUG, "Setting gain: %f", value);
+    
+    if (direction == SOAPY_SDR_RX and name == "DIGITAL")
+    {
+        d_gain = MIN(MAX(value, 0.0), 48.0);
+        d_gain_scaler = std::pow(10.0, d_gain / 20.0);
+    }
 }
 
 double SoapyVfzfgpa::getGain(const int direction, const size_t channel, const std::string &name) const
 {
     SoapySDR_log(SOAPY_SDR_INFO, "getGain");
+    
+    if (direction == SOAPY_SDR_RX and name == "DIGITAL") {
+        return d_gain;
+    }
     return 0;
 }
 
 SoapySDR::Range SoapyVfzfgpa::getGainRange(const int direction, const size_t channel, const std::string &name) const
 {
     SoapySDR_log(SOAPY_SDR_INFO, "getGainRange");
+    
+    if (name == "DIGITAL") {
+        return SoapySDR::Range(0, 48);
+    }
     return SoapySDR::Range(0, 100);
 }
 
@@ -332,12 +1193,19 @@ void SoapyVfzfgpa::setFrequency(const int direction,
     
     if (name == "RF")
     {
-        d_freq_f << int(frequency);
-        d_freq_f.clear();
-        d_freq_f.seekg(0, std::ios::beg);
-        
+        if (writeFrequency(frequency) != 0) {
+            throw std::runtime_error("setFrequency failed to write frequency");
+        }
+    }
+}
+
+int SoapyVfzfgpa::writeFrequency(const double frequency)
+{
+    const int ret = sysfsWrite("frequency", std::to_string(int(frequency)));
+    if (ret == 0) {
         d_frequency = frequency;
     }
+    return ret;
 }
 
 double SoapyVfzfgpa::getFrequency(const int direction, const size_t channel, const std::string &name) const
@@ -418,24 +1286,328 @@ double SoapyVfzfgpa::getBandwidth(const int direction, const size_t channel) con
     return SoapySDR::Device::getBandwidth(direction, channel);
 }
 
+// Open every attribute of the board once, settings are then read and
+// written with pread/pwrite on the cached descriptor.
+void SoapyVfzfgpa::sysfsOpen(void)
+{
+    DIR *dir = opendir(kSysfsPath.c_str());
+    if (dir == nullptr) {
+        SoapySDR_logf(SOAPY_SDR_WARNING, "Can not open %s", kSysfsPath.c_str());
+        return;
+    }
+    
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != nullptr)
+    {
+        const std::string name = entry->d_name;
+        if (name[0] == '.' or name == "uevent") continue;
+        
+        // Skip device, subsystem and power
+        const std::string path = kSysfsPath + "/" + name;
+        struct stat st;
+        if (stat(path.c_str(), &st) != 0 or !S_ISREG(st.st_mode)) continue;
+        
+        // Command style attributes may be write only
+        sysfs_attr_t attr;
+        attr.readable = true;
+        attr.writable = true;
+        attr.fd = open(path.c_str(), O_RDWR | O_CLOEXEC);
+        if (attr.fd < 0) {
+            attr.writable = false;
+            attr.fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        }
+        if (attr.fd < 0) {
+            attr.readable = false;
+            attr.writable = true;
+            attr.fd = open(path.c_str(), O_WRONLY | O_CLOEXEC);
+        }
+        if (attr.fd < 0) continue;
+        
+        d_sysfs[name] = attr;
+        SoapySDR_logf(SOAPY_SDR_DEBUG, "sysfs attribute %s%s", name.c_str(), sysfsAccess(attr));
+    }
+    
+    closedir(dir);
+}
+
+int SoapyVfzfgpa::sysfsWrite(const std::string &key, const std::string &value)
+{
+    auto it = d_sysfs.find(key);
+    if (it == d_sysfs.end() or !it->second.writable) {
+        SoapySDR_logf(SOAPY_SDR_ERROR, "sysfs attribute %s not writable", key.c_str());
+        return -EACCES;
+    }
+    
+    if (pwrite(it->second.fd, value.c_str(), value.size(), 0) < 0) {
+        const int err = errno;
+        SoapySDR_logf(SOAPY_SDR_ERROR, "sysfs write %s=%s: %s", key.c_str(), value.c_str(), strerror(err));
+        return -err;
+    }
+    
+    return 0;
+}
+
+std::string SoapyVfzfgpa::sysfsRead(const std::string &key) const
+{
+    auto it = d_sysfs.find(key);
+    if (it == d_sysfs.end() or !it->second.readable) return "";
+    
+    char buf[4096];
+    const ssize_t n = pread(it->second.fd, buf, sizeof(buf), 0);
+    if (n <= 0) return "";
+    
+    std::string value(buf, n);
+    while (!value.empty() and (value.back() == '\n' or value.back() == ' ')) {
+        value.pop_back();
+    }
+    return value;
+}
+
+void SoapyVfzfgpa::sysfsApplyPending(void)
+{
+    std::lock_guard<std::mutex> lock(d_sysfs_mutex);
+    
+    for (auto &kv : d_sysfs_pending)
+    {
+        if (sysfsWrite(kv.first, kv.second) == 0 and kv.first == "frequency") {
+            d_frequency = std::stod(kv.second);
+        }
+    }
+    d_sysfs_pending.clear();
+    d_sysfs_dirty = false;
+}
+
 SoapySDR::ArgInfoList SoapyVfzfgpa::getSettingInfo(void) const
 {
     SoapySDR::ArgInfoList settings;
     
     SoapySDR_log(SOAPY_SDR_INFO, "getSettingInfo");
     
+    scan_settings_t scan;
+    {
+        std::lock_guard<std::mutex> lock(d_scan_mutex);
+        scan = d_scan_next;
+    }
+    
+    SoapySDR::ArgInfo scanArg;
+    scanArg.key = "scan";
+    scanArg.value = scan.enabled ? "true" : "false";
+    scanArg.name = "Frequency Scan";
+    scanArg.description = "Step through the scan frequencies, one dwell each. readStream sets END_BURST on the last block of a dwell.";
+    scanArg.type = SoapySDR::ArgInfo::BOOL;
+    settings.push_back(scanArg);
+    
+    SoapySDR::ArgInfo freqsArg;
+    freqsArg.key = "scan_frequencies";
+    freqsArg.value = "";
+    freqsArg.name = "Scan Frequencies";
+    freqsArg.description = "Comma separated list of centre frequencies.";
+    freqsArg.units = "Hz";
+    freqsArg.type = SoapySDR::ArgInfo::STRING;
+    settings.push_back(freqsArg);
+    
+    SoapySDR::ArgInfo rangeArg;
+    rangeArg.key = "scan_range";
+    rangeArg.value = "";
+    rangeArg.name = "Scan Range";
+    rangeArg.description = "Centre frequencies as start,stop,step.";
+    rangeArg.units = "Hz";
+    rangeArg.type = SoapySDR::ArgInfo::STRING;
+    settings.push_back(rangeArg);
+    
+    SoapySDR::ArgInfo dwellArg;
+    dwellArg.key = "scan_dwell";
+    dwellArg.value = std::to_string(scan.dwell);
+    dwellArg.name = "Scan Dwell";
+    dwellArg.description = "Samples delivered per frequency.";
+    dwellArg.units = "samples";
+    dwellArg.type = SoapySDR::ArgInfo::INT;
+    settings.push_back(dwellArg);
+    
+    SoapySDR::ArgInfo settleArg;
+    settleArg.key = "scan_settle";
+    settleArg.value = std::to_string(scan.settle);
+    settleArg.name = "Scan Settling";
+    settleArg.description = "Samples discarded after each retune, in addition to those captured before it.";
+    settleArg.units = "samples";
+    settleArg.type = SoapySDR::ArgInfo::INT;
+    settings.push_back(settleArg);
+    
+    SoapySDR::ArgInfo scanFreqArg;
+    scanFreqArg.key = "scan_frequency";
+    scanFreqArg.value = "0";
+    scanFreqArg.name = "Scan Block Frequency";
+    scanFreqArg.description = "Read only. Centre frequency of the block returned by the last readStream.";
+    scanFreqArg.units = "Hz";
+    scanFreqArg.type = SoapySDR::ArgInfo::FLOAT;
+    settings.push_back(scanFreqArg);
+    
+    SoapySDR::ArgInfo batchArg;
+    batchArg.key = "batch";
+    batchArg.value = "";
+    batchArg.name = "Batched Write";
+    batchArg.description = "Board settings as key=value, key=value. Applied together between periods while streaming.";
+    batchArg.type = SoapySDR::ArgInfo::STRING;
+    settings.push_back(batchArg);
+    
+    // Board attributes found in sysfs
+    for (auto &attr : d_sysfs)
+    {
+        SoapySDR::ArgInfo sysfsArg;
+        sysfsArg.key = attr.first;
+        sysfsArg.value = sysfsRead(attr.first);
+        sysfsArg.name = attr.first;
+        sysfsArg.description = kSysfsPath + "/" + attr.first + sysfsAccess(attr.second);
+        sysfsArg.type = SoapySDR::ArgInfo::STRING;
+        settings.push_back(sysfsArg);
+    }
+    
     return settings;
 }
 
 void SoapyVfzfgpa::writeSetting(const std::string &key, const std::string &value)
 {
-    SoapySDR_log(SOAPY_SDR_INFO, "writeSetting");
+    SoapySDR_logf(SOAPY_SDR_INFO, "writeSetting %s=%s", key.c_str(), value.c_str());
+    
+    if (key == "scan_frequencies")
+    {
+        std::vector<double> freqs;
+        std::stringstream ss(value);
+        std::string freq;
+        while (std::getline(ss, freq, ',')) {
+            freqs.push_back(std::stod(freq));
+        }
+        if (freqs.empty()) {
+            throw std::runtime_error("writeSetting scan_frequencies is empty");
+        }
+        scanCheck(freqs, getFrequencyRange(SOAPY_SDR_RX, 0, "RF").front());
+        
+        std::lock_guard<std::mutex> lock(d_scan_mutex);
+        d_scan_next.freqs = freqs;
+        d_scan_dirty = true;
+    }
+    else if (key == "scan_range")
+    {
+        double start = 0, stop = 0, step = 0;
+        char sep1 = 0, sep2 = 0;
+        std::stringstream ss(value);
+        ss >> start >> sep1 >> stop >> sep2 >> step;
+        if (ss.fail() or sep1 != ',' or sep2 != ',' or step <= 0) {
+            throw std::runtime_error("writeSetting scan_range expects start,stop,step");
+        }
+        
+        if (start > stop) {
+            throw std::runtime_error("writeSetting scan_range start is above stop");
+        }
+        
+        // Count first, a tiny step would otherwise allocate a huge list
+        const double count = std::floor((stop - start) / step + 1e-6) + 1;
+        if (count > kScanMaxFrequencies) {
+            throw std::runtime_error("writeSetting scan list longer than " + std::to_string(kScanMaxFrequencies));
+        }
+        
+        // Step by index so rounding does not accumulate
+        std::vector<double> freqs;
+        for (size_t i = 0; i < size_t(count); i++) {
+            freqs.push_back(MIN(start + i * step, stop));
+        }
+        scanCheck(freqs, getFrequencyRange(SOAPY_SDR_RX, 0, "RF").front());
+        
+        std::lock_guard<std::mutex> lock(d_scan_mutex);
+        d_scan_next.freqs = freqs;
+        d_scan_dirty = true;
+    }
+    else if (key == "scan_dwell")
+    {
+        const size_t dwell = std::stoul(value);
+        if (dwell == 0) {
+            throw std::runtime_error("writeSetting scan_dwell must be at least one sample");
+        }
+        
+        std::lock_guard<std::mutex> lock(d_scan_mutex);
+        d_scan_next.dwell = dwell;
+        d_scan_dirty = true;
+    }
+    else if (key == "scan_settle")
+    {
+        const size_t settle = std::stoul(value);
+        
+        std::lock_guard<std::mutex> lock(d_scan_mutex);
+        d_scan_next.settle = settle;
+        d_scan_dirty = true;
+    }
+    else if (key == "scan")
+    {
+        const bool enabled = value == "true";
+        if (enabled and d_burst_mode) {
+            throw std::runtime_error("writeSetting scan not available in burst mode");
+        }
+        
+        std::lock_guard<std::mutex> lock(d_scan_mutex);
+        if (enabled and (d_scan_next.freqs.empty() or d_scan_next.dwell == 0)) {
+            throw std::runtime_error("writeSetting scan needs frequencies and a dwell");
+        }
+        d_scan_next.enabled = enabled;
+        d_scan_dirty = true;
+    }
+    else if (key == "batch")
+    {
+        const SoapySDR::Kwargs batch = SoapySDR::KwargsFromString(value);
+        for (auto &kv : batch)
+        {
+            auto it = d_sysfs.find(kv.first);
+            if (it == d_sysfs.end() or !it->second.writable) {
+                throw std::runtime_error("writeSetting batch unknown or read only key " + kv.first);
+            }
+        }
+        
+        {
+            std::lock_guard<std::mutex> lock(d_sysfs_mutex);
+            for (auto &kv : batch) {
+                d_sysfs_pending[kv.first] = kv.second;
+            }
+            d_sysfs_dirty = true;
+        }
+        
+        // Not streaming, nothing to wait for
+        if (!rxStreaming()) {
+            sysfsApplyPending();
+        }
+    }
+    else if (d_sysfs.count(key))
+    {
+        if (sysfsWrite(key, value) != 0) {
+            throw std::runtime_error("writeSetting failed to write " + key);
+        }
+        if (key == "frequency") {
+            d_frequency = std::stod(value);
+        }
+    }
+    else
+    {
+        throw std::runtime_error("writeSetting unknown key " + key);
+    }
+    
+    // Not streaming, nothing to wait for
+    if (d_scan_dirty and !rxStreaming()) {
+        scanApplyPending();
+    }
 }
 
 std::string SoapyVfzfgpa::readSetting(const std::string &key) const
 {
     SoapySDR_log(SOAPY_SDR_INFO, "readSetting");
     
+    if (key == "scan_frequency") return std::to_string(d_scan_frequency);
+    if (key == "scan" or key == "scan_dwell" or key == "scan_settle")
+    {
+        std::lock_guard<std::mutex> lock(d_scan_mutex);
+        if (key == "scan") return d_scan_next.enabled ? "true" : "false";
+        if (key == "scan_dwell") return std::to_string(d_scan_next.dwell);
+        return std::to_string(d_scan_next.settle);
+    }
+    if (d_sysfs.count(key)) return sysfsRead(key);
+    
     return "empty";
 }
 
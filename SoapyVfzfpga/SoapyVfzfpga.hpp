@@ -15,9 +15,14 @@
 
 #include <cstdint>
 #include <iostream>
-#include <fstream>
+#include <deque>
+#include <map>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
 
 #include "alsa.h"
+#include "converters.hpp"
 
 #define MIN(a,b) (((a)<(b))?(a):(b))
 #define MAX(a,b) (((a)>(b))?(a):(b))
@@ -31,6 +36,32 @@ typedef enum stream_format_t
     STREAM_FORMAT_INT8,
 } stream_format_t;
 */
+
+// A captured burst in the burst queue
+typedef struct burst_t
+{
+    long long ticks;    // time of first frame in samples
+    size_t frames;      // frames queued so far
+    size_t consumed;    // frames handed to readStream
+    bool complete;      // post-trigger history has been captured
+} burst_t;
+
+// Frequency scan settings staged by writeSetting
+typedef struct scan_settings_t
+{
+    bool enabled;
+    std::vector<double> freqs;
+    size_t dwell;       // frames delivered per dwell
+    size_t settle;      // frames discarded after each retune
+} scan_settings_t;
+
+// An open attribute in /sys/class/sdr/vfzsdr
+typedef struct sysfs_attr_t
+{
+    int fd;
+    bool readable;
+    bool writable;
+} sysfs_attr_t;
  
 class SoapyVfzfgpa : public SoapySDR::Device
 {
@@ -44,11 +75,97 @@ private:
     bool d_agc_mode;
     double d_frequency;
     double d_sample_rate;
+    long long d_ticks;
     
     SoapySDR::ConverterRegistry::ConverterFunction d_converter_func;
     
-    // sysfs file handles
-    std::fstream d_freq_f;
+    // Burst capture
+    bool d_burst_mode;
+    float d_burst_threshold;            // power threshold in native units
+    size_t d_burst_pre;                 // pre-trigger history in frames
+    size_t d_burst_post;                // post-trigger history in frames
+    bool d_burst_active;
+    size_t d_burst_quiet;               // frames below threshold in active burst
+    std::vector<int32_t> d_burst_hist;  // pre-trigger ring buffer
+    size_t d_burst_hist_pos;
+    size_t d_burst_hist_len;
+    std::vector<int32_t> d_burst_data;  // queued bursts, native format
+    size_t d_burst_head;                // read position in d_burst_data in frames
+    std::deque<burst_t> d_bursts;
+    
+    // TX
+    snd_pcm_t* d_tx_pcm_handle;
+    std::vector<int32_t> d_tx_buff;
+    size_t d_tx_prefill;                // silence written before start in frames
+    bool d_tx_linked;                   // started and stopped together with RX
+    int d_tx_status;                    // pending readStreamStatus event, 0 if none
+    bool d_tx_xrun_reported;            // underflow seen in the PCM state and reported
+    std::mutex d_tx_status_mutex;
+    std::condition_variable d_tx_status_cond;
+    SoapySDR::ConverterRegistry::ConverterFunction d_tx_converter_func;
+    
+    // Frequency scan, only used by the streaming thread
+    bool d_scan_mode;
+    std::vector<double> d_scan_freqs;
+    size_t d_scan_index;
+    size_t d_scan_dwell;                // frames delivered per dwell
+    size_t d_scan_settle;               // frames discarded after each retune
+    size_t d_scan_discard;              // frames left to discard in this dwell
+    size_t d_scan_remaining;            // frames left to deliver in this dwell
+    std::atomic<double> d_scan_frequency;   // centre of the last block delivered
+    scan_settings_t d_scan_next;        // applied by readStream between periods
+    mutable std::mutex d_scan_mutex;
+    std::atomic<bool> d_scan_dirty;
+    
+    // sysfs attributes, opened once at construction
+    std::map<std::string, sysfs_attr_t> d_sysfs;
+    std::mutex d_sysfs_mutex;
+    SoapySDR::Kwargs d_sysfs_pending;   // batched writes for the next period
+    std::atomic<bool> d_sysfs_dirty;
+    
+    // Stages fused into the RX format converter
+    bool d_dc_mode;
+    dc_state_t d_dc_state;
+    dc_converter_t d_dc_converter_func;
+    double d_gain;                      // digital gain in dB
+    double d_gain_scaler;
+    
+    bool isTxStream(SoapySDR::Stream *stream) const;
+    int readPeriod(const size_t numElems, const long timeoutUs);
+    int readRecover(const int err);
+    bool rxStreaming(void);
+    int writePeriod(const size_t numElems, const long timeoutUs);
+    void txUnlink(void);
+    void txReport(const int status);
+    void convertRx(const int32_t *src, void *dst, const size_t frames);
+    int writeFrequency(const double frequency);
+    
+    // sysfs attributes
+    void sysfsOpen(void);
+    int sysfsWrite(const std::string &key, const std::string &value);
+    std::string sysfsRead(const std::string &key) const;
+    void sysfsApplyPending(void);
+    
+    // Frequency scan
+    void scanApplyPending(void);
+    int scanTune(const size_t index);
+    int readScan(void * const *buffs,
+                 const size_t numElems,
+                 int &flags,
+                 long long &timeNs,
+                 const long timeoutUs);
+    
+    // Burst capture
+    void burstReset(void);
+    void burstBreak(void);
+    void burstHistoryPush(const int32_t *src, size_t frames);
+    void burstQueue(const int32_t *src, const size_t frames);
+    void burstDetect(const size_t frames);
+    int readBurst(void * const *buffs,
+                  const size_t numElems,
+                  int &flags,
+                  long long &timeNs,
+                  const long timeoutUs);
     
 public:
     SoapyVfzfgpa();
@@ -85,6 +202,32 @@ public:
                    int &flags,
                    long long &timeNs,
                    const long timeoutUs = 100000);
+    
+    int writeStream(SoapySDR::Stream *stream,
+                    const void * const *buffs,
+                    const size_t numElems,
+                    int &flags,
+                    const long long timeNs = 0,
+                    const long timeoutUs = 100000);
+    
+    int readStreamStatus(SoapySDR::Stream *stream,
+                         size_t &chanMask,
+                         int &flags,
+                         long long &timeNs,
+                         const long timeoutUs = 100000);
+    
+    // Direct buffer access API, TX only
+    size_t getNumDirectAccessBuffers(SoapySDR::Stream *stream);
+    int getDirectAccessBufferAddrs(SoapySDR::Stream *stream, const size_t handle, void **buffs);
+    int acquireWriteBuffer(SoapySDR::Stream *stream,
+                           size_t &handle,
+                           void **buffs,
+                           const long timeoutUs = 100000);
+    void releaseWriteBuffer(SoapySDR::Stream *stream,
+                            const size_t handle,
+                            const size_t numElems,
+                            int &flags,
+                            const long long timeNs = 0);
 
     // Antennas
     std::vector<std::string> listAntennas(const int direction, const size_t channel) const;
@@ -93,6 +236,8 @@ public:
     
     // DC offset
     bool hasDCOffsetMode(const int direction, const size_t channel) const;
+    void setDCOffsetMode(const int direction, const size_t channel, const bool automatic);
+    bool getDCOffsetMode(const int direction, const size_t channel) const;
     
     // Gain
     std::vector<std::string> listGains(const int direction, const size_t channel) const;
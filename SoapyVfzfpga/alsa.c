@@ -8,7 +8,7 @@
 
 #include "alsa.h"
 
-/* Try to get an ALSA capture handle */
+/* Try to get an ALSA capture or playback handle */
 snd_pcm_t* alsa_pcm_handle(const char* pcm_name, snd_pcm_uframes_t frames, snd_pcm_stream_t stream) {
     snd_pcm_t *pcm_handle = NULL;
     snd_pcm_hw_params_t *hwparams;
@@ -86,6 +86,30 @@ snd_pcm_t* alsa_pcm_handle(const char* pcm_name, snd_pcm_uframes_t frames, snd_p
     snd_pcm_uframes_t bufs = 0;
     snd_pcm_hw_params_get_buffer_size(hwparams, &bufs);
     
+    /* Playback is started explicitly, either on its own or together with */
+    /* a linked capture stream. Never start on buffer fill. */
+    if (stream == SND_PCM_STREAM_PLAYBACK) {
+        snd_pcm_sw_params_t *swparams;
+        snd_pcm_uframes_t boundary = 0;
+        
+        snd_pcm_sw_params_alloca(&swparams);
+        
+        if (snd_pcm_sw_params_current(pcm_handle, swparams) < 0) {
+            fprintf(stderr, "Error getting SW params.\n");
+            exit(EXIT_FAILURE);
+        }
+        
+        snd_pcm_sw_params_get_boundary(swparams, &boundary);
+        if (snd_pcm_sw_params_set_start_threshold(pcm_handle, swparams, boundary) < 0) {
+            fprintf(stderr, "Error setting start threshold.\n");
+            exit(EXIT_FAILURE);
+        }
+        
+        if (snd_pcm_sw_params(pcm_handle, swparams) < 0) {
+            fprintf(stderr, "Error setting SW params.\n");
+            exit(EXIT_FAILURE);
+        }
+    }
 
 
     /*
@@ -0,0 +1,232 @@
+//
+//  converters.hpp
+//  SoapyVfzfpga
+//
+//  Format converter kernels. One loop is generated per combination of source
+//  format, destination format and fused stages, all branches on the template
+//  parameters fold away at compile time.
+//
+
+#ifndef converters_hpp
+#define converters_hpp
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <type_traits>
+
+// Sample formats. Samples are interleaved I/Q pairs of type. scale() is full
+// scale and lo()/hi() the clamp limits, both before offset() is added.
+struct cf64_t
+{
+    typedef double type;
+    static constexpr bool isFloat = true;
+    static constexpr int bits = 64;
+    static constexpr double scale() { return 1.0; }
+    static constexpr int offset() { return 0; }
+    static constexpr double lo() { return -1.0; }
+    static constexpr double hi() { return 1.0; }
+};
+
+struct cf32_t
+{
+    typedef float type;
+    static constexpr bool isFloat = true;
+    static constexpr int bits = 32;
+    static constexpr double scale() { return 1.0; }
+    static constexpr int offset() { return 0; }
+    static constexpr double lo() { return -1.0; }
+    static constexpr double hi() { return 1.0; }
+};
+
+struct cs32_t
+{
+    typedef int32_t type;
+    static constexpr bool isFloat = false;
+    static constexpr int bits = 32;
+    static constexpr double scale() { return 2147483648.0; }
+    static constexpr int offset() { return 0; }
+    static constexpr double lo() { return -2147483648.0; }
+    // Largest float below 2^31
+    static constexpr double hi() { return 2147483520.0; }
+};
+
+struct cs16_t
+{
+    typedef int16_t type;
+    static constexpr bool isFloat = false;
+    static constexpr int bits = 16;
+    static constexpr double scale() { return 32768.0; }
+    static constexpr int offset() { return 0; }
+    static constexpr double lo() { return -32768.0; }
+    static constexpr double hi() { return 32767.0; }
+};
+
+struct cs8_t
+{
+    typedef int8_t type;
+    static constexpr bool isFloat = false;
+    static constexpr int bits = 8;
+    static constexpr double scale() { return 128.0; }
+    static constexpr int offset() { return 0; }
+    static constexpr double lo() { return -128.0; }
+    static constexpr double hi() { return 127.0; }
+};
+
+struct cu8_t
+{
+    typedef uint8_t type;
+    static constexpr bool isFloat = false;
+    static constexpr int bits = 8;
+    static constexpr double scale() { return 128.0; }
+    static constexpr int offset() { return 128; }
+    static constexpr double lo() { return -128.0; }
+    static constexpr double hi() { return 127.0; }
+};
+
+// State of the DC removal stage, a first order high pass per I and Q
+typedef struct dc_state_t
+{
+    double i;
+    double q;
+} dc_state_t;
+
+// Converter with the fused DC removal stage
+typedef void (*dc_converter_t)(const void *srcBuff, void *dstBuff, const size_t numElems, const double scaler, dc_state_t &dc);
+
+template <typename Src, typename Dst, bool Scaled, bool DCRemove>
+struct converter_kernel
+{
+    typedef typename Src::type src_t;
+    typedef typename Dst::type dst_t;
+
+    // Double only when one side is double
+    typedef typename std::conditional<(Src::bits == 64 and Src::isFloat) or (Dst::bits == 64 and Dst::isFloat), double, float>::type calc_t;
+
+    // Same format at full scale is a copy
+    typedef std::integral_constant<bool, std::is_same<Src, Dst>::value and !Scaled and !DCRemove> is_copy;
+
+    // Integer to integer at full scale is just a shift
+    typedef std::integral_constant<bool, !Src::isFloat and !Dst::isFloat and !Scaled and !DCRemove> is_shift;
+
+    static void run(const void *srcBuff, void *dstBuff, const size_t numElems, const double scaler, dc_state_t *dc)
+    {
+        run(srcBuff, dstBuff, numElems, scaler, dc, is_copy());
+    }
+
+private:
+    static void run(const void *srcBuff, void *dstBuff, const size_t numElems, const double scaler, dc_state_t *dc, std::true_type)
+    {
+        const size_t elemDepth = 2;
+        std::memcpy(dstBuff, srcBuff, numElems * elemDepth * sizeof(src_t));
+    }
+
+    static void run(const void *srcBuff, void *dstBuff, const size_t numElems, const double scaler, dc_state_t *dc, std::false_type)
+    {
+        convert(srcBuff, dstBuff, numElems, scaler, dc, is_shift());
+    }
+
+    static void convert(const void *srcBuff, void *dstBuff, const size_t numElems, const double scaler, dc_state_t *dc, std::true_type)
+    {
+        const size_t elemDepth = 2;
+        const int down = Src::bits > Dst::bits ? Src::bits - Dst::bits : 0;
+        const int up = Dst::bits > Src::bits ? Dst::bits - Src::bits : 0;
+        // Round half up like store() by adding the highest bit shifted out.
+        // That may carry past the largest value of the type.
+        const int round = down > 0 ? down - 1 : 0;
+        const int32_t half = down > 0 ? 1 : 0;
+        const int32_t hi = int32_t(std::numeric_limits<dst_t>::max()) - Dst::offset();
+
+        auto *src = (const src_t*)srcBuff;
+        auto *dst = (dst_t*)dstBuff;
+        for (size_t i = 0; i < numElems*elemDepth; i++)
+        {
+            const int32_t x = int32_t(src[i]) - Src::offset();
+            const int32_t y = ((x >> down) + ((x >> round) & half)) * (1 << up);
+            dst[i] = dst_t(std::min(y, hi) + Dst::offset());
+        }
+    }
+
+    static void convert(const void *srcBuff, void *dstBuff, const size_t numElems, const double scaler, dc_state_t *dc, std::false_type)
+    {
+        const calc_t gain = calc_t((Scaled ? scaler : 1.0) * Dst::scale() / Src::scale());
+        const double alpha = 1.0 / 4096;
+
+        // In double, in float the steps get lost below the estimate's LSB
+        double dcI = 0, dcQ = 0;
+        if (DCRemove) {
+            dcI = dc->i;
+            dcQ = dc->q;
+        }
+
+        auto *src = (const src_t*)srcBuff;
+        auto *dst = (dst_t*)dstBuff;
+        for (size_t i = 0; i < numElems; i++)
+        {
+            calc_t re = calc_t(src[2*i]) - Src::offset();
+            calc_t im = calc_t(src[2*i + 1]) - Src::offset();
+
+            if (DCRemove) {
+                dcI += alpha * (re - dcI);
+                dcQ += alpha * (im - dcQ);
+                re = calc_t(re - dcI);
+                im = calc_t(im - dcQ);
+            }
+
+            dst[2*i] = store(re * gain);
+            dst[2*i + 1] = store(im * gain);
+        }
+
+        if (DCRemove) {
+            dc->i = dcI;
+            dc->q = dcQ;
+        }
+    }
+
+    static dst_t store(calc_t x)
+    {
+        return store(x, std::integral_constant<bool, Dst::isFloat>());
+    }
+
+    static dst_t store(calc_t x, std::true_type)
+    {
+        return dst_t(x);
+    }
+
+    // Clamp and round half up, int32_t() truncates so correct it to floor.
+    // No branches or calls, so the loop vectorizes.
+    static dst_t store(calc_t x, std::false_type)
+    {
+        x = std::min(std::max(x, calc_t(Dst::lo())), calc_t(Dst::hi()));
+        x += calc_t(0.5);
+
+        int32_t y = int32_t(x);
+        y -= calc_t(y) > x;
+        return dst_t(y + Dst::offset());
+    }
+};
+
+// ConverterRegistry entry points. The scaler is a fused gain stage.
+template <typename Src, typename Dst>
+void genericConvert(const void *srcBuff, void *dstBuff, const size_t numElems, const double scaler)
+{
+    if (scaler == 1.0) {
+        converter_kernel<Src, Dst, false, false>::run(srcBuff, dstBuff, numElems, scaler, nullptr);
+    } else {
+        converter_kernel<Src, Dst, true, false>::run(srcBuff, dstBuff, numElems, scaler, nullptr);
+    }
+}
+
+template <typename Src, typename Dst>
+void genericConvertDC(const void *srcBuff, void *dstBuff, const size_t numElems, const double scaler, dc_state_t &dc)
+{
+    if (scaler == 1.0) {
+        converter_kernel<Src, Dst, false, true>::run(srcBuff, dstBuff, numElems, scaler, &dc);
+    } else {
+        converter_kernel<Src, Dst, true, true>::run(srcBuff, dstBuff, numElems, scaler, &dc);
+    }
+}
+
+#endif /* converters_hpp */
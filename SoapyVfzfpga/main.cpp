@@ -5,11 +5,120 @@
 //  Created by Albin Stigö on 21/05/2018.
 //  Copyright © 2018 Albin Stigo. All rights reserved.
 //
+//  Loopback check for the TX path. Plays an impulse and counts the RX
+//  samples until it comes back, a few times over. With the snd-aloop module
+//  loaded and the plugin on SOAPY_SDR_PLUGIN_PATH:
+//
+//      vfzloopback hw:Loopback,0 hw:Loopback,1
+//
+//  The latency must be the same on every run. With a null device the
+//  impulse never comes back, "vfzloopback null null" only checks that both
+//  streams run without errors.
+//
 
+#include <SoapySDR/Device.hpp>
+#include <SoapySDR/Errors.hpp>
+#include <SoapySDR/Formats.hpp>
+
+#include <cmath>
 #include <iostream>
+#include <vector>
+
+static const int kRuns = 3;
+static const int kMaxBlocks = 64;
+
+// Samples from RX activation to the impulse, or -1 if it never came back.
+// False on a stream error.
+static bool measureLatency(SoapySDR::Device *device, const std::string &txPcm, const std::string &rxPcm, long long &latency)
+{
+    SoapySDR::Kwargs txArgs, rxArgs;
+    txArgs["pcm"] = txPcm;
+    rxArgs["pcm"] = rxPcm;
+
+    SoapySDR::Stream *rx = device->setupStream(SOAPY_SDR_RX, SOAPY_SDR_CF32, std::vector<size_t>(), rxArgs);
+    SoapySDR::Stream *tx = device->setupStream(SOAPY_SDR_TX, SOAPY_SDR_CF32, std::vector<size_t>(), txArgs);
+
+    const size_t mtu = device->getStreamMTU(rx);
+    std::vector<float> txBuff(2 * mtu, 0.0f);
+    std::vector<float> rxBuff(2 * mtu);
+
+    // TX first so the two are linked
+    device->activateStream(tx);
+    device->activateStream(rx);
+
+    bool ok = true;
+    long long received = 0;
+    latency = -1;
+    txBuff[0] = 0.9f;
+
+    for (int block = 0; block < kMaxBlocks and latency < 0; block++)
+    {
+        int flags = 0;
+        long long timeNs = 0;
+
+        const void *txBuffs[] = {txBuff.data()};
+        int ret = device->writeStream(tx, txBuffs, mtu, flags);
+        if (ret < 0) {
+            std::cerr << "writeStream " << SoapySDR::errToStr(ret) << std::endl;
+            ok = false;
+            break;
+        }
+        txBuff[0] = 0.0f;
+
+        void *rxBuffs[] = {rxBuff.data()};
+        ret = device->readStream(rx, rxBuffs, mtu, flags, timeNs);
+        if (ret < 0) {
+            std::cerr << "readStream " << SoapySDR::errToStr(ret) << std::endl;
+            ok = false;
+            break;
+        }
+
+        for (int i = 0; i < ret; i++)
+        {
+            if (std::fabs(rxBuff[2*i]) > 0.5f) {
+                latency = received + i;
+                break;
+            }
+        }
+        received += ret;
+    }
+
+    device->deactivateStream(tx);
+    device->deactivateStream(rx);
+    device->closeStream(tx);
+    device->closeStream(rx);
+
+    return ok;
+}
 
 int main(int argc, const char * argv[]) {
-    // insert code here...
-    std::cout << "Hello, World!\n";
-    return 0;
+    const std::string txPcm = argc > 1 ? argv[1] : "hw:Loopback,0";
+    const std::string rxPcm = argc > 2 ? argv[2] : "hw:Loopback,1";
+
+    // Nothing comes back from a null device
+    const bool loopback = txPcm != "null" and rxPcm != "null";
+
+    SoapySDR::Device *device = SoapySDR::Device::make("driver=vfzfpga");
+
+    long long first = 0;
+    bool pass = true;
+    for (int run = 0; run < kRuns; run++)
+    {
+        long long latency = -1;
+        const bool ok = measureLatency(device, txPcm, rxPcm, latency);
+
+        if (loopback) {
+            std::cout << "run " << run << ": latency " << latency << " samples" << std::endl;
+            if (run == 0) first = latency;
+            pass = pass and ok and latency >= 0 and latency == first;
+        } else {
+            std::cout << "run " << run << ": " << (ok ? "streamed" : "stream error") << std::endl;
+            pass = pass and ok;
+        }
+    }
+
+    SoapySDR::Device::unmake(device);
+
+    std::cout << (pass ? "PASS" : "FAIL") << std::endl;
+    return pass ? 0 : 1;
 }